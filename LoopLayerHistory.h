@@ -0,0 +1,444 @@
+/*
+  ==============================================================================
+
+    LoopLayerHistory.h
+    Created: 19 Oct 2026 2:37:08pm
+    Author:  Easton Elting
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "PendingLoopBuffer.h"
+
+// Undo/redo history for the loop buffer.
+//
+// The loop is split into fixed size pages and each layer is just a table of
+// shared pointers to pages, so taking a snapshot copies pointers, not audio.
+// The audio thread flags the pages a block actually changed and a background
+// thread copies only those out of the loop, duplicating a page only if a
+// committed layer still shares it.
+//
+// In collect mode a layer is one pass of the loop and costs only the pages
+// that got non-silent input during it. With collect mode off every block
+// overwrites the loop, so that whole stretch is a single layer: its pages are
+// copied once and then updated in place until it's committed by switching
+// collect mode or pressing undo. Undo and redo build the restored loop off
+// the audio thread and hand it over through a PendingLoopBuffer.
+//
+// Pass boundaries are cut on the audio thread. If the next pass is about to
+// write into a page the background hasn't copied for the pass that just
+// ended, the audio thread saves that page into one of a few preallocated
+// slots first, so the finished layer never picks up the new overdub.
+class LoopLayerHistory  : private juce::TimeSliceClient
+{
+public:
+    LoopLayerHistory(juce::TimeSliceThread& thread, juce::AudioBuffer<float>& loop, juce::SpinLock& loopLock)
+        : backgroundThread(thread), loopBuffer(loop), loopBufferLock(loopLock)
+    {
+        backgroundThread.addTimeSliceClient(this);
+    }
+
+    ~LoopLayerHistory() override
+    {
+        backgroundThread.removeTimeSliceClient(this);
+    }
+
+    // Starts a fresh history from whatever is in the loop. Call from
+    // prepareToPlay, after the loop buffer has been sized.
+    void prepare()
+    {
+        const juce::ScopedLock lock(historyLock);
+        const juce::SpinLock::ScopedLockType loopLock(loopBufferLock);
+
+        numChannels = loopBuffer.getNumChannels();
+        numSamples = loopBuffer.getNumSamples();
+        numPages = (numSamples + pageSize - 1) / pageSize;
+        for (auto& dirty : dirtyPages) {
+            dirty.reset(new std::atomic<int>[(size_t) numPages]);
+        }
+        clearDirtyPages();
+
+        savedPages.reset(new SavedPage[(size_t) maxSavedPages]);
+        for (int slot = 0; slot < maxSavedPages; ++slot) {
+            savedPages[slot].audio.setSize(numChannels, pageSize);
+        }
+
+        working.clear();
+        for (int page = 0; page < numPages; ++page) {
+            working.push_back(std::make_shared<Page>(numChannels, getPageLength(page)));
+            copyPageFromLoop(page);
+        }
+
+        layers = { working };
+        currentLayer = 0;
+        changedSinceCommit = false;
+        syncedPass = passCount.load();
+    }
+
+    // Audio thread. Flags the pages covered by a write that changed the loop,
+    // wrapping like the loop does.
+    void markWritten(int startSample, int length)
+    {
+        if (numPages == 0) {
+            return;
+        }
+
+        auto& dirty = dirtyPages[passCount.load(std::memory_order_relaxed) & 1];
+        auto loopRemaining = numSamples - startSample;
+        if (loopRemaining >= length) {
+            markPages(dirty, startSample, length);
+        } else {
+            markPages(dirty, startSample, loopRemaining);
+            markPages(dirty, 0, length - loopRemaining);
+        }
+    }
+
+    // Audio thread, before writing into the loop. Saves any page the last
+    // finished pass changed that the background hasn't copied yet. The range
+    // mustn't wrap, the processor splits its writes at the end of the loop.
+    void aboutToWrite(int startSample, int length)
+    {
+        if (numPages == 0 || length <= 0) {
+            return;
+        }
+
+        auto closingPass = passCount.load(std::memory_order_relaxed) - 1;
+        auto& closing = dirtyPages[closingPass & 1];
+        for (int page = startSample / pageSize; page <= (startSample + length - 1) / pageSize; ++page) {
+            auto state = closing[page].load(std::memory_order_acquire);
+            if (state == dirty || state == copying) {
+                savePage(closing, page, closingPass, state);
+            }
+        }
+    }
+
+    // Audio thread. Ends the current layer exactly here: pages written from now
+    // on are flagged in the other generation, so they can't leak into it.
+    void passComplete() { passCount.fetch_add(1, std::memory_order_release); }
+
+    // Audio thread, after something replaced the whole loop. An undo or redo
+    // that's older than that, published or still being built, gets dropped and
+    // the new contents become a layer of their own.
+    void loopReplaced()
+    {
+        replaceEpoch.fetch_add(1, std::memory_order_release);
+        pending.discard();
+        markWritten(0, numSamples);
+        passComplete();
+    }
+
+    // Audio thread. Returns true if an undone or redone layer was swapped in.
+    bool exchangeIfReady(juce::AudioBuffer<float>& loop)
+    {
+        if (! pending.isReady()) {
+            return false;
+        }
+        if (pendingEpoch.load(std::memory_order_acquire) != replaceEpoch.load(std::memory_order_relaxed)) {
+            pending.discard();
+            return false;
+        }
+        return pending.exchangeIfReady(loop);
+    }
+
+    // Closes the current layer early, e.g. when collect mode is switched.
+    void commitLayer()
+    {
+        const juce::ScopedLock lock(historyLock);
+        syncPasses();
+        commit();
+    }
+
+    bool undo()
+    {
+        const juce::ScopedLock lock(historyLock);
+        syncPasses();
+
+        // on the newest layer, whatever's been written since is worth coming
+        // back to with redo. Further back it's only what played in since the
+        // last undo, which mustn't wipe out the layers that can be redone.
+        if (currentLayer == (int) layers.size() - 1) {
+            commit();
+        }
+
+        if (currentLayer == 0) {
+            return false;
+        }
+        --currentLayer;
+        restoreCurrentLayer();
+        return true;
+    }
+
+    bool redo()
+    {
+        const juce::ScopedLock lock(historyLock);
+        if (currentLayer + 1 >= (int) layers.size()) {
+            return false;
+        }
+        ++currentLayer;
+        restoreCurrentLayer();
+        return true;
+    }
+
+private:
+    using Page = juce::AudioBuffer<float>;
+    using Layer = std::vector<std::shared_ptr<Page>>;
+    using DirtyFlags = std::unique_ptr<std::atomic<int>[]>;
+
+    enum PageState { clean, dirty, copying, saved };
+
+    // A page the audio thread copied out of the loop just before overwriting
+    // it. page is -1 while the slot is free, pass says which layer it's for.
+    struct SavedPage
+    {
+        Page audio;
+        int pass { 0 };
+        std::atomic<int> page { -1 };
+    };
+
+    // ~93ms at 44.1k, small enough that a partial overdub only touches a few pages
+    static constexpr int pageSize { 4096 };
+    // worst case every layer owns all of its pages, so this caps memory at that many loops
+    static constexpr int maxLayers { 8 };
+    // the background copies a pass's last pages within a slice or two, this
+    // covers well over a second of it being held up by disk writes
+    static constexpr int maxSavedPages { 16 };
+
+    int useTimeSlice() override
+    {
+        const juce::ScopedLock lock(historyLock);
+        syncPasses();
+        return 20;
+    }
+
+    // Commits every pass the audio thread has finished, then keeps the working
+    // layer up to date with the one in progress. Syncing as we go means that by
+    // the time a pass ends only its last few pages are left to copy.
+    void syncPasses()
+    {
+        if (numPages == 0) {
+            return;
+        }
+
+        auto pass = passCount.load(std::memory_order_acquire);
+        while (syncedPass != pass) {
+            syncDirtyPages(syncedPass);
+            commit();
+            ++syncedPass;
+        }
+        syncDirtyPages(pass);
+
+        // anything still saved for a committed pass was left over from a
+        // restore or a skipped sync, and would otherwise hold its slot forever
+        for (int slot = 0; slot < maxSavedPages; ++slot) {
+            if (savedPages[slot].page.load(std::memory_order_acquire) >= 0 && savedPages[slot].pass < syncedPass) {
+                savedPages[slot].page.store(-1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Audio thread. Takes a free slot, copies the page into it and then hands
+    // the page over by marking it saved. If the background finished its own
+    // copy first, that copy was taken before this write too, and the slot is
+    // given back.
+    void savePage(DirtyFlags& closing, int page, int closingPass, int state)
+    {
+        SavedPage* slot = nullptr;
+        for (int index = 0; index < maxSavedPages && slot == nullptr; ++index) {
+            if (savedPages[index].page.load(std::memory_order_acquire) < 0) {
+                slot = &savedPages[index];
+            }
+        }
+        if (slot == nullptr) {
+            // every slot is in use, this page will be copied late and may pick
+            // up the start of the new pass
+            return;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            slot->audio.copyFrom(channel, 0, loopBuffer, channel, page * pageSize, getPageLength(page));
+        }
+        slot->pass = closingPass;
+        slot->page.store(page, std::memory_order_release);
+
+        while (state == dirty || state == copying) {
+            if (closing[page].compare_exchange_weak(state, saved, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+        slot->page.store(-1, std::memory_order_release);
+    }
+
+    // Background thread. Puts the audio thread's copy of a page into the
+    // working layer instead of what's in the loop now.
+    void takeSavedPage(DirtyFlags& flags, int page, int pass)
+    {
+        for (int slot = 0; slot < maxSavedPages; ++slot) {
+            auto& savedPage = savedPages[slot];
+            if (savedPage.page.load(std::memory_order_acquire) == page && savedPage.pass == pass) {
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    getWritablePage(page).copyFrom(channel, 0, savedPage.audio, channel, 0, getPageLength(page));
+                }
+                savedPage.page.store(-1, std::memory_order_release);
+                changedSinceCommit = true;
+                break;
+            }
+        }
+        flags[page].store(clean, std::memory_order_relaxed);
+    }
+
+    int getPageLength(int page) const
+    {
+        return juce::jmin(pageSize, numSamples - page * pageSize);
+    }
+
+    void markPages(DirtyFlags& dirty, int startSample, int length)
+    {
+        if (length <= 0) {
+            return;
+        }
+        for (int page = startSample / pageSize; page <= (startSample + length - 1) / pageSize; ++page) {
+            dirty[page].store(PageState::dirty, std::memory_order_release);
+        }
+    }
+
+    void clearDirtyPages()
+    {
+        for (auto& flags : dirtyPages) {
+            for (int page = 0; page < numPages; ++page) {
+                flags[page].store(clean, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Copy on write: a page still shared with a committed layer gets its own
+    // copy, one only the working layer holds is overwritten in place.
+    Page& getWritablePage(int page)
+    {
+        if (working[page].use_count() > 1) {
+            working[page] = std::make_shared<Page>(numChannels, getPageLength(page));
+        }
+        return *working[page];
+    }
+
+    void copyPageFromLoop(int page)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            working[page]->copyFrom(channel, 0, loopBuffer, channel, page * pageSize, getPageLength(page));
+        }
+    }
+
+    void syncDirtyPages(int pass)
+    {
+        // the loop is about to be replaced by a restored layer, whatever is in
+        // it now doesn't belong to the working layer any more
+        if (numPages == 0 || pending.isReady()) {
+            return;
+        }
+
+        const juce::SpinLock::ScopedLockType loopLock(loopBufferLock);
+        if (loopBuffer.getNumChannels() != numChannels || loopBuffer.getNumSamples() != numSamples) {
+            return;
+        }
+
+        auto& flags = dirtyPages[pass & 1];
+        for (int page = 0; page < numPages; ++page) {
+            auto state = flags[page].load(std::memory_order_acquire);
+            if (state == clean) {
+                continue;
+            }
+            if (state == saved || ! flags[page].compare_exchange_strong(state, copying, std::memory_order_acq_rel)) {
+                if (state == saved) {
+                    takeSavedPage(flags, page, pass);
+                }
+                continue;
+            }
+
+            getWritablePage(page);
+            copyPageFromLoop(page);
+            changedSinceCommit = true;
+
+            // written again while copying means it gets copied again next time,
+            // saved means the audio thread's copy is the one to keep
+            state = copying;
+            if (! flags[page].compare_exchange_strong(state, clean, std::memory_order_acq_rel) && state == saved) {
+                takeSavedPage(flags, page, pass);
+            }
+        }
+    }
+
+    void commit()
+    {
+        if (! changedSinceCommit) {
+            return;
+        }
+
+        // a new layer after an undo drops the layers that could have been redone
+        layers.erase(layers.begin() + currentLayer + 1, layers.end());
+        layers.push_back(working);
+        if ((int) layers.size() > maxLayers) {
+            layers.erase(layers.begin());
+        }
+        currentLayer = (int) layers.size() - 1;
+        changedSinceCommit = false;
+    }
+
+    void restoreCurrentLayer()
+    {
+        auto epoch = replaceEpoch.load(std::memory_order_acquire);
+
+        working = layers[(size_t) currentLayer];
+        changedSinceCommit = false;
+        clearDirtyPages();
+        for (int slot = 0; slot < maxSavedPages; ++slot) {
+            savedPages[slot].page.store(-1, std::memory_order_release);
+        }
+        syncedPass = passCount.load(std::memory_order_acquire);
+
+        auto& restored = pending.acquire();
+        restored.setSize(numChannels, numSamples, false, false, true);
+        for (int page = 0; page < numPages; ++page) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                restored.copyFrom(channel, page * pageSize, *working[page], channel, 0, getPageLength(page));
+            }
+        }
+
+        // a file was loaded while this was being built, the load is newer so
+        // it stays. exchangeIfReady checks again in case it lands after this.
+        if (replaceEpoch.load(std::memory_order_acquire) != epoch) {
+            return;
+        }
+        pendingEpoch.store(epoch, std::memory_order_release);
+        pending.publish();
+    }
+
+    juce::TimeSliceThread& backgroundThread;
+    juce::AudioBuffer<float>& loopBuffer;
+    juce::SpinLock& loopBufferLock;
+
+    juce::CriticalSection historyLock;
+    int numChannels { 0 };
+    int numSamples { 0 };
+    int numPages { 0 };
+    // one set of flags per generation, the audio thread flips between them in passComplete()
+    DirtyFlags dirtyPages[2];
+    std::unique_ptr<SavedPage[]> savedPages;
+
+    Layer working;
+    std::vector<Layer> layers;
+    int currentLayer { 0 };
+    bool changedSinceCommit { false };
+
+    std::atomic<int> passCount { 0 };
+    int syncedPass { 0 };
+
+    // bumped by every loaded file, a restore built before a load is dropped
+    std::atomic<int> replaceEpoch { 0 };
+    std::atomic<int> pendingEpoch { 0 };
+    PendingLoopBuffer pending;
+};
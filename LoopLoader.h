@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    LoopLoader.h
+    Created: 19 Oct 2026 11:02:55am
+    Author:  Easton Elting
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PendingLoopBuffer.h"
+
+// Loads an audio file into a buffer shaped like the loop buffer on its own
+// worker thread. Wav and aiff files are memory mapped so only the part that
+// fits in the loop is ever read from disk, and the result is resampled to the
+// processor's rate before it's handed to the audio thread.
+class LoopLoader  : private juce::Thread
+{
+public:
+    LoopLoader() : juce::Thread("Habit Delay Loop Loader")
+    {
+        startThread();
+    }
+
+    ~LoopLoader() override
+    {
+        stopThread(4000);
+    }
+
+    void load(const juce::File& file, int numChannels, int numSamples, double sampleRate)
+    {
+        {
+            const juce::ScopedLock lock(requestLock);
+            request = { file, numChannels, numSamples, sampleRate };
+            hasRequest = true;
+        }
+        notify();
+    }
+
+    // Audio thread. Returns true if the loaded file was swapped into loopBuffer.
+    bool exchangeIfReady(juce::AudioBuffer<float>& loopBuffer) { return pending.exchangeIfReady(loopBuffer); }
+
+private:
+    struct Request
+    {
+        juce::File file;
+        int numChannels { 0 };
+        int numSamples { 0 };
+        double sampleRate { 0 };
+    };
+
+    void run() override
+    {
+        while (! threadShouldExit()) {
+            Request next;
+            bool loadNext = false;
+            {
+                const juce::ScopedLock lock(requestLock);
+                std::swap(loadNext, hasRequest);
+                next = request;
+            }
+
+            if (loadNext) {
+                loadFile(next);
+            } else {
+                wait(-1);
+            }
+        }
+    }
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> createReader(const juce::File& file)
+    {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+        if (wavFormat.canHandleFile(file)) {
+            reader.reset(wavFormat.createMemoryMappedReader(file));
+        } else if (aiffFormat.canHandleFile(file)) {
+            reader.reset(aiffFormat.createMemoryMappedReader(file));
+        }
+        return reader;
+    }
+
+    void loadFile(const Request& next)
+    {
+        if (next.numChannels <= 0 || next.numSamples <= 0 || next.sampleRate <= 0) {
+            return;
+        }
+
+        auto reader = createReader(next.file);
+        if (reader == nullptr || reader->sampleRate <= 0) {
+            return;
+        }
+
+        // only map as much of the file as the loop can hold, plus a few samples
+        // of lookahead for the interpolator
+        auto speedRatio = reader->sampleRate / next.sampleRate;
+        auto sourceSamples = (juce::int64) std::ceil(next.numSamples * speedRatio) + 4;
+        sourceSamples = juce::jmin(sourceSamples, reader->lengthInSamples);
+        if (sourceSamples <= 0 || ! reader->mapSectionOfFile({ 0, sourceSamples })) {
+            return;
+        }
+
+        source.setSize(next.numChannels, (int) sourceSamples + 4, false, false, true);
+        source.clear();
+        reader->read(&source, 0, (int) sourceSamples, 0, true, true);
+
+        if (threadShouldExit()) {
+            return;
+        }
+
+        auto& loaded = pending.acquire();
+        loaded.setSize(next.numChannels, next.numSamples, false, false, true);
+        loaded.clear();
+
+        auto numOutputSamples = juce::jmin(next.numSamples, (int) (sourceSamples / speedRatio));
+        for (int channel = 0; channel < next.numChannels; ++channel) {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(speedRatio, source.getReadPointer(channel), loaded.getWritePointer(channel), numOutputSamples);
+        }
+
+        pending.publish();
+    }
+
+    juce::WavAudioFormat wavFormat;
+    juce::AiffAudioFormat aiffFormat;
+
+    juce::CriticalSection requestLock;
+    Request request;
+    bool hasRequest { false };
+
+    juce::AudioBuffer<float> source;
+    PendingLoopBuffer pending;
+};
@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    LoopRecorder.h
+    Created: 19 Oct 2026 10:21:37am
+    Author:  Easton Elting
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Streams audio to a wav file. The audio thread only pushes samples into the
+// ThreadedWriter's lock-free fifo, the actual disk writes happen on the
+// background thread that's passed in.
+class LoopRecorder
+{
+public:
+    enum Source { wetOutput, loopInput };
+
+    LoopRecorder(juce::TimeSliceThread& thread) : backgroundThread(thread) {}
+
+    ~LoopRecorder() { stop(); }
+
+    bool start(const juce::File& file, double sampleRate, int numChannels, Source sourceToRecord)
+    {
+        stop();
+
+        if (sampleRate <= 0 || numChannels <= 0 || numChannels > maxChannels) {
+            return false;
+        }
+
+        // record next to the target and only replace it once the take is
+        // finished, so a failed start never costs the user their old file
+        std::unique_ptr<juce::TemporaryFile> newTempFile(new juce::TemporaryFile(file));
+        std::unique_ptr<juce::FileOutputStream> stream(newTempFile->getFile().createOutputStream());
+        if (stream == nullptr || stream->failedToOpen()) {
+            return false;
+        }
+
+        juce::WavAudioFormat wavFormat;
+        auto* writer = wavFormat.createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels, 24, {}, 0);
+        if (writer == nullptr) {
+            return false;
+        }
+        stream.release(); // the writer owns the stream now
+        tempFile = std::move(newTempFile);
+
+        // about a second and a half of headroom at 44.1k before the fifo fills up
+        threadedWriter.reset(new juce::AudioFormatWriter::ThreadedWriter(writer, backgroundThread, 65536));
+
+        const juce::SpinLock::ScopedLockType lock(writerLock);
+        source = sourceToRecord;
+        writerChannels = numChannels;
+        overruns = 0;
+        activeWriter = threadedWriter.get();
+        return true;
+    }
+
+    void stop()
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(writerLock);
+            activeWriter = nullptr;
+        }
+
+        // flushes whatever is still in the fifo and closes the file
+        threadedWriter.reset();
+
+        if (tempFile != nullptr) {
+            tempFile->overwriteTargetFileWithTemporary();
+            tempFile.reset();
+        }
+    }
+
+    bool isRecording() const { return activeWriter.load() != nullptr; }
+
+    // Message thread. The file's channel count is fixed when it's started.
+    int getNumChannels() const { return writerChannels; }
+
+    // Number of writes dropped because the fifo was full or the buffer handed
+    // in had fewer channels than the file.
+    int getNumOverruns() const { return overruns.load(); }
+
+    // Audio thread. Copies numSamples starting at startSample if buffer is the
+    // source being recorded, wrapping around the end of buffer the same way the
+    // loop and delay buffers do.
+    void write(Source bufferSource, const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        const juce::SpinLock::ScopedTryLockType lock(writerLock);
+        auto* writer = activeWriter.load();
+        if (! lock.isLocked() || writer == nullptr || bufferSource != source) {
+            return;
+        }
+
+        // the fifo reads every channel of the file, so a short buffer can't be written
+        if (buffer.getNumChannels() < writerChannels) {
+            ++overruns;
+            return;
+        }
+
+        auto bufferRemaining = buffer.getNumSamples() - startSample;
+        if (bufferRemaining >= numSamples) {
+            writeChannels(*writer, buffer, startSample, numSamples);
+        } else {
+            writeChannels(*writer, buffer, startSample, bufferRemaining);
+            writeChannels(*writer, buffer, 0, numSamples - bufferRemaining);
+        }
+    }
+
+private:
+    static constexpr int maxChannels { 8 };
+
+    void writeChannels(juce::AudioFormatWriter::ThreadedWriter& writer, const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        const float* channels[maxChannels] = {};
+        for (int channel = 0; channel < writerChannels; ++channel) {
+            channels[channel] = buffer.getReadPointer(channel, startSample);
+        }
+        if (! writer.write(channels, numSamples)) {
+            ++overruns;
+        }
+    }
+
+    juce::TimeSliceThread& backgroundThread;
+    std::unique_ptr<juce::TemporaryFile> tempFile;
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> threadedWriter;
+    std::atomic<juce::AudioFormatWriter::ThreadedWriter*> activeWriter { nullptr };
+    juce::SpinLock writerLock;
+    Source source { wetOutput };
+    int writerChannels { 0 };
+    std::atomic<int> overruns { 0 };
+};
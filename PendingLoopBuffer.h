@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    PendingLoopBuffer.h
+    Created: 19 Oct 2026 10:04:12am
+    Author:  Easton Elting
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// A single slot for handing a fully prepared loop buffer to the audio thread.
+// A background thread fills the slot and publishes it, the audio thread swaps
+// it with the live buffer (no allocation, just pointer moves) and the old
+// contents are left behind in the slot to be reused for the next hand-off.
+class PendingLoopBuffer
+{
+public:
+    // Background thread only. Waits out a swap that's in progress and
+    // reclaims a buffer that was published but never picked up.
+    juce::AudioBuffer<float>& acquire()
+    {
+        for (;;) {
+            auto expected = ready;
+            if (state.compare_exchange_strong(expected, idle) || expected == idle) {
+                return buffer;
+            }
+            juce::Thread::sleep(1);
+        }
+    }
+
+    // Background thread only, after filling the buffer returned by acquire().
+    void publish() { state.store(ready, std::memory_order_release); }
+
+    bool isReady() const { return state.load(std::memory_order_acquire) == ready; }
+
+    // Audio thread. Swaps the published buffer into live if it still has the
+    // same shape (prepareToPlay may have resized live in the meantime).
+    bool exchangeIfReady(juce::AudioBuffer<float>& live)
+    {
+        auto expected = ready;
+        if (! state.compare_exchange_strong(expected, swapping, std::memory_order_acquire)) {
+            return false;
+        }
+
+        bool sameShape = buffer.getNumChannels() == live.getNumChannels()
+                      && buffer.getNumSamples() == live.getNumSamples();
+        if (sameShape) {
+            std::swap(buffer, live);
+        }
+
+        state.store(idle, std::memory_order_release);
+        return sameShape;
+    }
+
+    // Audio thread. Drops a published buffer that's been overtaken by something
+    // newer, leaving it in the slot to be reused.
+    void discard()
+    {
+        auto expected = ready;
+        state.compare_exchange_strong(expected, idle, std::memory_order_acq_rel);
+    }
+
+private:
+    enum State { idle, ready, swapping };
+
+    juce::AudioBuffer<float> buffer;
+    std::atomic<State> state { idle };
+};
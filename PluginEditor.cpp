@@ -106,13 +106,130 @@ HabitDelayAudioProcessorEditor::HabitDelayAudioProcessorEditor (HabitDelayAudioP
     collectModeButton.setColour(juce::ToggleButton::textColourId, juce::Colours::black);
     collectModeButton.setColour(juce::ToggleButton::tickColourId, juce::Colours::black);
     collectModeButton.setButtonText("Collect Mode");
+    
+    addAndMakeVisible(programBox);
+    updateProgramNames();
+    programBox.onChange = [&] {
+        audioProcessor.setCurrentProgram(programBox.getSelectedItemIndex());
+        showProgram(programBox.getSelectedItemIndex());
+    };
+    
+    addAndMakeVisible(storeButton);
+    storeButton.setButtonText("Store");
+    storeButton.onClick = [&] {
+        audioProcessor.storeProgram(audioProcessor.getCurrentProgram());
+    };
+    
+    addAndMakeVisible(recordButton);
+    recordButton.setButtonText("Record");
+    recordButton.onClick = [&] {
+        if (audioProcessor.isRecording()) {
+            audioProcessor.stopRecording();
+            recordButton.setButtonText("Record");
+            return;
+        }
+        
+        fileChooser.reset(new juce::FileChooser("Record to...",
+                                                juce::File::getSpecialLocation(juce::File::userMusicDirectory).getChildFile("Habit Delay.wav"),
+                                                "*.wav"));
+        fileChooser->launchAsync(juce::FileBrowserComponent::saveMode
+                                 | juce::FileBrowserComponent::canSelectFiles
+                                 | juce::FileBrowserComponent::warnAboutOverwriting,
+                                 [&] (const juce::FileChooser& chooser) {
+            auto file = chooser.getResult();
+            if (file != juce::File() && audioProcessor.startRecording(file.withFileExtension("wav"), recordLoopButton.getToggleState())) {
+                recordButton.setButtonText("Stop");
+            }
+        });
+    };
+    
+    addAndMakeVisible(recordLoopButton);
+    recordLoopButton.setColour(juce::ToggleButton::textColourId, juce::Colours::black);
+    recordLoopButton.setColour(juce::ToggleButton::tickColourId, juce::Colours::black);
+    recordLoopButton.setButtonText("Record Loop");
+    
+    addAndMakeVisible(loadButton);
+    loadButton.setButtonText("Load");
+    loadButton.onClick = [&] {
+        fileChooser.reset(new juce::FileChooser("Load into the loop...",
+                                                juce::File::getSpecialLocation(juce::File::userMusicDirectory),
+                                                "*.wav;*.aif;*.aiff"));
+        fileChooser->launchAsync(juce::FileBrowserComponent::openMode
+                                 | juce::FileBrowserComponent::canSelectFiles,
+                                 [&] (const juce::FileChooser& chooser) {
+            auto file = chooser.getResult();
+            if (file.existsAsFile()) {
+                audioProcessor.loadLoopFromFile(file);
+            }
+        });
+    };
+    
+    addAndMakeVisible(undoButton);
+    undoButton.setButtonText("Undo");
+    undoButton.onClick = [&] { audioProcessor.undoLoopLayer(); };
+    
+    addAndMakeVisible(redoButton);
+    redoButton.setButtonText("Redo");
+    redoButton.onClick = [&] { audioProcessor.redoLoopLayer(); };
+    
+    // programs can also be changed by the host, so keep an eye out for that
+    showProgram(audioProcessor.getCurrentProgram());
+    startTimerHz(10);
 }
 
 HabitDelayAudioProcessorEditor::~HabitDelayAudioProcessorEditor()
 {
+    stopTimer();
     setLookAndFeel (nullptr);
 }
 
+void HabitDelayAudioProcessorEditor::timerCallback()
+{
+    // a recording can also be stopped by prepareToPlay
+    recordButton.setButtonText(audioProcessor.isRecording() ? "Stop" : "Record");
+    
+    // the host can rename programs or restore a whole bank
+    updateProgramNames();
+    if (audioProcessor.getCurrentProgram() != shownProgram) {
+        showProgram(audioProcessor.getCurrentProgram());
+    }
+}
+
+void HabitDelayAudioProcessorEditor::updateProgramNames()
+{
+    bool namesChanged = programBox.getNumItems() != audioProcessor.getNumPrograms();
+    for (int index = 0; index < audioProcessor.getNumPrograms() && ! namesChanged; ++index) {
+        namesChanged = programBox.getItemText(index) != audioProcessor.getProgramName(index);
+    }
+    if (! namesChanged) {
+        return;
+    }
+    
+    programBox.clear(juce::dontSendNotification);
+    for (int index = 0; index < audioProcessor.getNumPrograms(); ++index) {
+        programBox.addItem(audioProcessor.getProgramName(index), index + 1);
+    }
+    if (shownProgram >= 0) {
+        programBox.setSelectedItemIndex(shownProgram, juce::dontSendNotification);
+    }
+}
+
+void HabitDelayAudioProcessorEditor::showProgram(int index)
+{
+    shownProgram = index;
+    programBox.setSelectedItemIndex(index, juce::dontSendNotification);
+    
+    // same units the sliders hand to the processor
+    auto& program = audioProcessor.getProgram(index);
+    auto sampleRate = audioProcessor.getSampleRate();
+    levelSlider.setValue(program.level, juce::dontSendNotification);
+    feedbackSlider.setValue(program.feedback, juce::dontSendNotification);
+    delayRateSlider.setValue(std::log2(program.delayRate * 16), juce::dontSendNotification);
+    cutoffSlider.setValue(program.cutoff, juce::dontSendNotification);
+    loopSpreadSlider.setValue(program.loopSpreadSeconds * sampleRate, juce::dontSendNotification);
+    loopScanSlider.setValue(program.loopScanSeconds * sampleRate, juce::dontSendNotification);
+}
+
 //==============================================================================
 void HabitDelayAudioProcessorEditor::paint (juce::Graphics& g)
 {
@@ -137,4 +254,13 @@ void HabitDelayAudioProcessorEditor::resized()
     loopScanLabel.setBounds(offset + 3 * margin + 2 * sliderBoxSide, top + 2 * margin + 2 * sliderBoxSide + labelHeight, sliderBoxSide, labelHeight);
     
     collectModeButton.setBounds(offset + margin, top + 3 * margin + 2 * sliderBoxSide + 2 * labelHeight, sliderBoxSide, labelHeight);
+    programBox.setBounds(offset + 2 * margin + sliderBoxSide, top + 3 * margin + 2 * sliderBoxSide + 2 * labelHeight, sliderBoxSide, labelHeight);
+    storeButton.setBounds(offset + 3 * margin + 2 * sliderBoxSide, top + 3 * margin + 2 * sliderBoxSide + 2 * labelHeight, sliderBoxSide, labelHeight);
+    
+    recordButton.setBounds(offset + margin, top + 4 * margin + 2 * sliderBoxSide + 3 * labelHeight, sliderBoxSide, labelHeight);
+    recordLoopButton.setBounds(offset + 2 * margin + sliderBoxSide, top + 4 * margin + 2 * sliderBoxSide + 3 * labelHeight, sliderBoxSide, labelHeight);
+    loadButton.setBounds(offset + 3 * margin + 2 * sliderBoxSide, top + 4 * margin + 2 * sliderBoxSide + 3 * labelHeight, sliderBoxSide, labelHeight);
+    
+    undoButton.setBounds(offset + margin, top + 5 * margin + 2 * sliderBoxSide + 4 * labelHeight, sliderBoxSide, labelHeight);
+    redoButton.setBounds(offset + 2 * margin + sliderBoxSide, top + 5 * margin + 2 * sliderBoxSide + 4 * labelHeight, sliderBoxSide, labelHeight);
 }
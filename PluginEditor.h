@@ -15,7 +15,8 @@
 //==============================================================================
 /**
 */
-class HabitDelayAudioProcessorEditor  : public juce::AudioProcessorEditor
+class HabitDelayAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                        private juce::Timer
 {
 public:
     HabitDelayAudioProcessorEditor (HabitDelayAudioProcessor&);
@@ -47,6 +48,12 @@ public:
     }
 
 private:
+    void timerCallback() override;
+    
+    // moves the knobs to where a program has them
+    void showProgram(int index);
+    void updateProgramNames();
+    
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     HabitDelayAudioProcessor& audioProcessor;
@@ -80,4 +87,16 @@ private:
     juce::Label loopScanLabel;
     
     juce::ToggleButton collectModeButton;
+    
+    juce::ComboBox programBox;
+    juce::TextButton storeButton;
+    int shownProgram { -1 };
+    
+    juce::TextButton recordButton;
+    juce::ToggleButton recordLoopButton;
+    juce::TextButton loadButton;
+    std::unique_ptr<juce::FileChooser> fileChooser;
+    
+    juce::TextButton undoButton;
+    juce::TextButton redoButton;
 };
@@ -26,10 +26,13 @@ HabitDelayAudioProcessor::HabitDelayAudioProcessor()
         loopBuffer()
 #endif
 {
+    backgroundThread.startThread();
 }
 
 HabitDelayAudioProcessor::~HabitDelayAudioProcessor()
 {
+    loopRecorder.stop();
+    backgroundThread.stopThread(4000);
 }
 
 //==============================================================================
@@ -72,35 +75,138 @@ double HabitDelayAudioProcessor::getTailLengthSeconds() const
 
 int HabitDelayAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return ProgramBank::numPrograms;
 }
 
 int HabitDelayAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return programBank.getCurrentProgram();
 }
 
 void HabitDelayAudioProcessor::setCurrentProgram (int index)
 {
+    if (isPositiveAndBelow(index, ProgramBank::numPrograms)) {
+        programBank.select(index);
+    }
 }
 
 const juce::String HabitDelayAudioProcessor::getProgramName (int index)
 {
-    return {};
+    if (! isPositiveAndBelow(index, ProgramBank::numPrograms)) {
+        return {};
+    }
+    return programBank.getProgram(index).name;
 }
 
 void HabitDelayAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
+    if (isPositiveAndBelow(index, ProgramBank::numPrograms)) {
+        programBank.setProgramName(index, newName);
+    }
+}
+
+void HabitDelayAudioProcessor::storeProgram(int index)
+{
+    if (! isPositiveAndBelow(index, ProgramBank::numPrograms)) {
+        return;
+    }
+    
+    ProgramParameters program;
+    program.name = programBank.getProgram(index).name;
+    program.level = level;
+    program.feedback = delayFade;
+    program.delayRate = jlimit(ProgramBank::minDelayRate, ProgramBank::maxDelayRate, delayRate);
+    program.cutoff = cutoff;
+    if (lastSampleRate > 0) {
+        program.loopSpreadSeconds = (float) loopSpread / lastSampleRate;
+        program.loopScanSeconds = (float) loopScan / lastSampleRate;
+    }
+    programBank.setProgram(index, program, makeProgramSnapshot(program));
+}
+
+ProgramSnapshot HabitDelayAudioProcessor::makeProgramSnapshot(const ProgramParameters& program)
+{
+    // programs can come from host state, so nothing here is trusted to be in range
+    ProgramSnapshot snapshot;
+    snapshot.level = jlimit(0.0f, 1.0f, program.level);
+    snapshot.feedback = jlimit(0.0f, 1.0f, program.feedback);
+    snapshot.delayRate = jlimit(ProgramBank::minDelayRate, ProgramBank::maxDelayRate, program.delayRate);
+    snapshot.cutoff = jmax(1.0f, program.cutoff);
+    
+    // everything else depends on the sample rate, prepareToPlay fills it in
+    if (lastSampleRate <= 0) {
+        return snapshot;
+    }
+    
+    // the delay out position has to land inside delayBuffer
+    snapshot.samplesOfDelay = jlimit(0.0f, (float) jmax(0, delayBuffer.getNumSamples() - 1), getSamplesOfDelay(snapshot.delayRate));
+    
+    auto loopLength = lastSampleRate * loopBufferSizeInSeconds;
+    snapshot.loopSpread = jlimit(0, loopLength - 1, roundToInt(program.loopSpreadSeconds * lastSampleRate));
+    snapshot.loopScan = jlimit(0, loopLength - 1, roundToInt(program.loopScanSeconds * lastSampleRate));
+    
+    dsp::StateVariableFilter::Parameters<float> filter;
+    filter.type = dsp::StateVariableFilter::Parameters<float>::Type::highPass;
+    snapshot.cutoff = jmin(snapshot.cutoff, lastSampleRate * 0.49f);
+    filter.setCutOffFrequency(lastSampleRate, snapshot.cutoff);
+    snapshot.filterG = filter.g;
+    snapshot.filterR2 = filter.R2;
+    snapshot.filterH = filter.h;
+    
+    return snapshot;
+}
+
+void HabitDelayAudioProcessor::updateProgramSnapshots()
+{
+    for (int index = 0; index < ProgramBank::numPrograms; ++index) {
+        programBank.setSnapshot(index, makeProgramSnapshot(programBank.getProgram(index)));
+    }
+}
+
+bool HabitDelayAudioProcessor::applyPendingProgram()
+{
+    ProgramSnapshot snapshot;
+    if (! programBank.takePendingSnapshot(snapshot)) {
+        return false;
+    }
+    
+    fadeFrom.loopSpreadPosition = getLoopSpreadPosition();
+    fadeFrom.loopScanPosition = getLoopScanPosition();
+    fadeFrom.delayOutPosition = getDelayOutPosition();
+    fadeFrom.level = level;
+    fadeFrom.feedback = delayFade;
+    
+    level = snapshot.level;
+    delayFade = snapshot.feedback;
+    delayRate = snapshot.delayRate;
+    samplesOfDelay = snapshot.samplesOfDelay;
+    loopSpread = snapshot.loopSpread;
+    loopScan = snapshot.loopScan;
+    
+    cutoff = snapshot.cutoff;
+    stateVariableFilter.state->g = snapshot.filterG;
+    stateVariableFilter.state->R2 = snapshot.filterR2;
+    stateVariableFilter.state->h = snapshot.filterH;
+    
+    return true;
 }
 
 //==============================================================================
 void HabitDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    loopBuffer.setSize(getTotalNumInputChannels(),
-                       sampleRate * loopBufferSizeInSeconds,
-                       true,
-                       true);
+    // the file's channel count can't change mid recording
+    if (loopRecorder.isRecording() && loopRecorder.getNumChannels() != getTotalNumInputChannels()) {
+        loopRecorder.stop();
+    }
+    
+    {
+        const SpinLock::ScopedLockType lock(loopBufferLock);
+        loopBuffer.setSize(getTotalNumInputChannels(),
+                           sampleRate * loopBufferSizeInSeconds,
+                           true,
+                           true);
+    }
+    loopHistory.prepare();
     
     lastSampleRate = sampleRate;
     
@@ -113,13 +219,17 @@ void HabitDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerB
     updateFilter(cutoff);
     stateVariableFilter.prepare(spec);
     
-    setDelayRate(delayRate);
-    
     float bufferDelayRate = pow(2.0, MAX_DELAY_RATE) / 16;
     float bps = bpm / 60;
     float secPerBeat = 1 / bps;
-    float samplesOfDelay = (bufferDelayRate * secPerBeat * getSampleRate());
-    delayBuffer.setSize(getTotalNumInputChannels(), (float)samplesOfDelay, true, true);
+    float maxSamplesOfDelay = (bufferDelayRate * secPerBeat * getSampleRate());
+    delayBuffer.setSize(getTotalNumInputChannels(), (float)maxSamplesOfDelay, true, true);
+    
+    // delayRate is already in beats, only the samples depend on the new rate
+    samplesOfDelay = jlimit(0.0f, (float) jmax(0, delayBuffer.getNumSamples() - 1), getSamplesOfDelay(delayRate));
+    
+    // snapshots are clamped to the delay buffer, so it has to be sized first
+    updateProgramSnapshots();
 }
 
 void HabitDelayAudioProcessor::releaseResources()
@@ -163,25 +273,62 @@ bool HabitDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
 
 void HabitDelayAudioProcessor::loopPositionIn(int totalNumInputChannels, juce::AudioBuffer<float> & buffer)
 {
-    // loopPosition in
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-        if (loopBuffer.getNumSamples() > loopPosition + buffer.getNumSamples()) {
-            if (collectMode) {
-                loopBuffer.addFrom(channel, loopPosition, buffer, channel, 0, buffer.getNumSamples());
+    // a loaded file or an undone layer swaps in whole, the old loop goes back to
+    // where it came from instead of being freed here. If the history is busy
+    // copying pages out of the loop, the swap waits for the next block. A load
+    // wins over an undo that hasn't been swapped in yet.
+    {
+        const SpinLock::ScopedTryLockType lock(loopBufferLock);
+        if (lock.isLocked()) {
+            if (loopLoader.exchangeIfReady(loopBuffer)) {
+                loopHistory.loopReplaced();
             } else {
-                loopBuffer.copyFrom(channel, loopPosition, buffer, channel, 0, buffer.getNumSamples());
+                loopHistory.exchangeIfReady(loopBuffer);
             }
+        }
+    }
+    
+    // loopPosition in. In collect mode each pass is its own layer, so a block
+    // that wraps ends the pass right between its two halves
+    if (loopBuffer.getNumSamples() > loopPosition + buffer.getNumSamples()) {
+        writeToLoop(totalNumInputChannels, buffer, 0, loopPosition, buffer.getNumSamples());
+    } else {
+        auto loopBufferRemaining = loopBuffer.getNumSamples() - loopPosition;
+        writeToLoop(totalNumInputChannels, buffer, 0, loopPosition, loopBufferRemaining);
+        if (collectMode) {
+            loopHistory.passComplete();
+        }
+        writeToLoop(totalNumInputChannels, buffer, loopBufferRemaining, 0, buffer.getNumSamples() - loopBufferRemaining);
+    }
+    
+    loopRecorder.write(LoopRecorder::loopInput, loopBuffer, loopPosition, buffer.getNumSamples());
+}
+
+void HabitDelayAudioProcessor::writeToLoop(int totalNumInputChannels, juce::AudioBuffer<float>& buffer, int bufferPosition, int loopStart, int length)
+{
+    if (length <= 0) {
+        return;
+    }
+    
+    // adding silence in collect mode leaves the loop as it was, so the history
+    // doesn't need to copy those pages
+    bool changedLoop = ! collectMode;
+    for (int channel = 0; channel < totalNumInputChannels && ! changedLoop; ++channel) {
+        changedLoop = buffer.getMagnitude(channel, bufferPosition, length) > 0;
+    }
+    if (! changedLoop) {
+        return;
+    }
+    
+    loopHistory.aboutToWrite(loopStart, length);
+    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+        if (collectMode) {
+            loopBuffer.addFrom(channel, loopStart, buffer, channel, bufferPosition, length);
         } else {
-            auto loopBufferRemaining = loopBuffer.getNumSamples() - loopPosition;
-            if (collectMode) {
-                loopBuffer.addFrom(channel, loopPosition, buffer, channel, 0, loopBufferRemaining);
-                loopBuffer.addFrom(channel, 0, buffer, channel, loopBufferRemaining, buffer.getNumSamples() - loopBufferRemaining);
-            } else {
-                loopBuffer.copyFrom(channel, loopPosition, buffer, channel, 0, loopBufferRemaining);
-                loopBuffer.copyFrom(channel, 0, buffer, channel, loopBufferRemaining, buffer.getNumSamples() - loopBufferRemaining);
-            }
+            loopBuffer.copyFrom(channel, loopStart, buffer, channel, bufferPosition, length);
         }
     }
+    loopHistory.markWritten(loopStart, length);
 }
 
 void HabitDelayAudioProcessor::circularBufferCopy(int totalNumInputChannels, juce::AudioBuffer<float>& inBuffer, juce::AudioBuffer<float>& outBuffer, int copyLen, int inPosition, int outPosition, float delayFade)
@@ -226,6 +373,24 @@ void HabitDelayAudioProcessor::circularBufferCopy(int totalNumInputChannels, juc
     }
 }
 
+void HabitDelayAudioProcessor::circularBufferCopyWithRamp(int totalNumInputChannels, juce::AudioBuffer<float>& inBuffer, juce::AudioBuffer<float>& outBuffer, int copyLen, int inPosition, int outPosition, float startFade, float endFade)
+{
+    // same as circularBufferCopy, but the gain ramps from startFade to endFade
+    // over copyLen, split wherever either buffer wraps
+    int copied = 0;
+    while (copied < copyLen) {
+        auto inIndex = (inPosition + copied) % inBuffer.getNumSamples();
+        auto outIndex = (outPosition + copied) % outBuffer.getNumSamples();
+        auto chunkLen = jmin(copyLen - copied, inBuffer.getNumSamples() - inIndex, outBuffer.getNumSamples() - outIndex);
+        auto chunkStartFade = startFade + (endFade - startFade) * copied / copyLen;
+        auto chunkEndFade = startFade + (endFade - startFade) * (copied + chunkLen) / copyLen;
+        for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+            outBuffer.addFromWithRamp(channel, outIndex, inBuffer.getReadPointer(channel, inIndex), chunkLen, chunkStartFade, chunkEndFade);
+        }
+        copied += chunkLen;
+    }
+}
+
 void HabitDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
@@ -235,14 +400,28 @@ void HabitDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
+    // a program switch fades from the old taps to the new ones over this block
+    bool crossfade = applyPendingProgram();
+    
     loopPositionIn(totalNumInputChannels, buffer);
     
     delayBuffer.clear(delayPosition, buffer.getNumSamples());
     
     // delay in
-    circularBufferCopy(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopSpreadPosition(), delayPosition, level);
-    if (getLoopScanPosition() != getLoopSpreadPosition()) {
-        circularBufferCopy(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopScanPosition(), delayPosition, level);
+    if (crossfade) {
+        circularBufferCopyWithRamp(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), fadeFrom.loopSpreadPosition, delayPosition, fadeFrom.level, 0);
+        if (fadeFrom.loopScanPosition != fadeFrom.loopSpreadPosition) {
+            circularBufferCopyWithRamp(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), fadeFrom.loopScanPosition, delayPosition, fadeFrom.level, 0);
+        }
+        circularBufferCopyWithRamp(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopSpreadPosition(), delayPosition, 0, level);
+        if (getLoopScanPosition() != getLoopSpreadPosition()) {
+            circularBufferCopyWithRamp(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopScanPosition(), delayPosition, 0, level);
+        }
+    } else {
+        circularBufferCopy(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopSpreadPosition(), delayPosition, level);
+        if (getLoopScanPosition() != getLoopSpreadPosition()) {
+            circularBufferCopy(totalNumInputChannels, loopBuffer, delayBuffer, buffer.getNumSamples(), getLoopScanPosition(), delayPosition, level);
+        }
     }
     
     AudioBuffer<float> noFilter;
@@ -253,18 +432,28 @@ void HabitDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
     buffer.clear();
     
     // delay out
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-        if (delayBuffer.getNumSamples() > getDelayOutPosition() + buffer.getNumSamples()) {
-            buffer.addFrom(channel, 0, delayBuffer, channel, getDelayOutPosition(), buffer.getNumSamples());
-        } else {
-            auto delayBufferRemaining = delayBuffer.getNumSamples() - getDelayOutPosition();
-            buffer.addFrom(channel, 0, delayBuffer, channel, getDelayOutPosition(), delayBufferRemaining);
-            buffer.addFrom(channel, delayBufferRemaining, delayBuffer, channel, 0, buffer.getNumSamples() - delayBufferRemaining);
+    if (crossfade) {
+        circularBufferCopyWithRamp(totalNumInputChannels, delayBuffer, buffer, buffer.getNumSamples(), fadeFrom.delayOutPosition, 0, 1, 0);
+        circularBufferCopyWithRamp(totalNumInputChannels, delayBuffer, buffer, buffer.getNumSamples(), getDelayOutPosition(), 0, 0, 1);
+    } else {
+        for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+            if (delayBuffer.getNumSamples() > getDelayOutPosition() + buffer.getNumSamples()) {
+                buffer.addFrom(channel, 0, delayBuffer, channel, getDelayOutPosition(), buffer.getNumSamples());
+            } else {
+                auto delayBufferRemaining = delayBuffer.getNumSamples() - getDelayOutPosition();
+                buffer.addFrom(channel, 0, delayBuffer, channel, getDelayOutPosition(), delayBufferRemaining);
+                buffer.addFrom(channel, delayBufferRemaining, delayBuffer, channel, 0, buffer.getNumSamples() - delayBufferRemaining);
+            }
         }
     }
     
     // delay feedback
-    circularBufferCopy(totalNumInputChannels, delayBuffer, delayBuffer, buffer.getNumSamples(), getDelayOutPosition(), delayPosition, delayFade);
+    if (crossfade) {
+        circularBufferCopyWithRamp(totalNumInputChannels, delayBuffer, delayBuffer, buffer.getNumSamples(), fadeFrom.delayOutPosition, delayPosition, fadeFrom.feedback, 0);
+        circularBufferCopyWithRamp(totalNumInputChannels, delayBuffer, delayBuffer, buffer.getNumSamples(), getDelayOutPosition(), delayPosition, 0, delayFade);
+    } else {
+        circularBufferCopy(totalNumInputChannels, delayBuffer, delayBuffer, buffer.getNumSamples(), getDelayOutPosition(), delayPosition, delayFade);
+    }
     
     if (feedMode) {
         
@@ -276,15 +465,28 @@ void HabitDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
     delayPosition += buffer.getNumSamples();
     delayPosition %= delayBuffer.getNumSamples();
     
+    // coefficients are only recalculated when the cutoff or program changes
     dsp::AudioBlock<float> block(buffer);
-    updateFilter(cutoff);
     stateVariableFilter.process(dsp::ProcessContextReplacing<float> (block));
     
+    loopRecorder.write(LoopRecorder::wetOutput, buffer, 0, buffer.getNumSamples());
+    
     for (int channel = 0; channel < totalNumInputChannels; ++channel) {
         buffer.addFrom(channel, 0, noFilter, channel, 0, buffer.getNumSamples());
     }
 }
 
+bool HabitDelayAudioProcessor::startRecording(const juce::File& file, bool shouldRecordLoop)
+{
+    return loopRecorder.start(file, getSampleRate(), getTotalNumInputChannels(),
+                              shouldRecordLoop ? LoopRecorder::loopInput : LoopRecorder::wetOutput);
+}
+
+void HabitDelayAudioProcessor::loadLoopFromFile(const juce::File& file)
+{
+    loopLoader.load(file, getTotalNumInputChannels(), lastSampleRate * loopBufferSizeInSeconds, lastSampleRate);
+}
+
 //==============================================================================
 bool HabitDelayAudioProcessor::hasEditor() const
 {
@@ -299,15 +501,15 @@ juce::AudioProcessorEditor* HabitDelayAudioProcessor::createEditor()
 //==============================================================================
 void HabitDelayAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    programBank.writeTo(destData);
 }
 
 void HabitDelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    if (programBank.readFrom(data, sizeInBytes)) {
+        updateProgramSnapshots();
+        programBank.select(programBank.getCurrentProgram());
+    }
 }
 
 //==============================================================================
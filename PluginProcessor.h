@@ -10,6 +10,10 @@
 
 #include <JuceHeader.h>
 #include <math.h>
+#include "LoopRecorder.h"
+#include "LoopLoader.h"
+#include "LoopLayerHistory.h"
+#include "ProgramBank.h"
 
 //==============================================================================
 /**
@@ -74,6 +78,7 @@ public:
     
     void setDelayRate(float newDelayRate) {
         delayRate = pow(2.0, newDelayRate) / 16;
+        samplesOfDelay = getSamplesOfDelay(delayRate);
     };
     
     void setLoopSpread(float newLoopSpread) { loopSpread = newLoopSpread; };
@@ -81,11 +86,15 @@ public:
     
     void setLoopScan(float newLoopScan) { loopScan = newLoopScan; };
 
-    int getDelayOutPosition()
+    float getSamplesOfDelay(float rate)
     {
         float bps = bpm / 60;
         float secPerBeat = 1 / bps;
-        float samplesOfDelay = (delayRate * secPerBeat * getSampleRate());
+        return rate * secPerBeat * getSampleRate();
+    }
+    
+    int getDelayOutPosition()
+    {
         return delayPosition >= samplesOfDelay ?
                delayPosition - samplesOfDelay :
                delayBuffer.getNumSamples() - samplesOfDelay + delayPosition;
@@ -95,16 +104,46 @@ public:
     
     void loopPositionIn(int totalNumInputChannels, juce::AudioBuffer<float>& buffer);
     
+    void writeToLoop(int totalNumInputChannels, juce::AudioBuffer<float>& buffer, int bufferPosition, int loopStart, int length);
+    
     void circularBufferCopy(int totalNumInputChannels, juce::AudioBuffer<float>& inBuffer, juce::AudioBuffer<float>& outBuffer, int copyLen, int inPosition, int outPosition, float delayFade = 1);
+    
+    void circularBufferCopyWithRamp(int totalNumInputChannels, juce::AudioBuffer<float>& inBuffer, juce::AudioBuffer<float>& outBuffer, int copyLen, int inPosition, int outPosition, float startFade, float endFade);
 
     void updateFilter(float freq);
     
-    void toggleCollectMode(bool clicked) { collectMode = clicked; };
+    void toggleCollectMode(bool clicked)
+    {
+        collectMode = clicked;
+        loopHistory.commitLayer();
+    };
+    
+    // records the wet output, or what's being written into the loop if shouldRecordLoop is set
+    bool startRecording(const juce::File& file, bool shouldRecordLoop);
+    void stopRecording() { loopRecorder.stop(); };
+    bool isRecording() const { return loopRecorder.isRecording(); };
+    int getRecordingOverruns() const { return loopRecorder.getNumOverruns(); };
+    
+    // replaces the loop with the start of the file once it's been loaded
+    void loadLoopFromFile(const juce::File& file);
+    
+    // steps back and forth through the loop's layers: each collect mode pass,
+    // or each stretch of overwriting between collect mode switches
+    bool undoLoopLayer() { return loopHistory.undo(); };
+    bool redoLoopLayer() { return loopHistory.redo(); };
+    
+    // saves the current knob settings into a program of the bank
+    void storeProgram(int index);
+    const ProgramParameters& getProgram(int index) const { return programBank.getProgram(index); };
     
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HabitDelayAudioProcessor)
     
+    ProgramSnapshot makeProgramSnapshot(const ProgramParameters& program);
+    void updateProgramSnapshots();
+    bool applyPendingProgram();
+    
     int lastSampleRate{ };
     juce::dsp::ProcessorDuplicator<juce::dsp::StateVariableFilter::Filter<float>, juce::dsp::StateVariableFilter::Parameters<float>> stateVariableFilter;
     float cutoff { 1 };
@@ -119,11 +158,36 @@ private:
     
     juce::AudioBuffer<float> delayBuffer;
     const float MAX_DELAY_RATE { 7 };
-    float delayRate { 1 };
+    // setDelayRate(1), what the delay rate slider starts at
+    float delayRate { 2.0f / 16 };
     int bpm { 128 };
+    float samplesOfDelay { 0 };
     int delayPosition { 0 };
     float delayFade { 0 };
     
     bool collectMode { false };
     bool feedMode { false };
+    
+    juce::TimeSliceThread backgroundThread { "Habit Delay Background" };
+    LoopRecorder loopRecorder { backgroundThread };
+    LoopLoader loopLoader;
+    
+    // held by anything reading loopBuffer off the audio thread, the audio thread
+    // only ever try-locks it before swapping a new loop in
+    juce::SpinLock loopBufferLock;
+    LoopLayerHistory loopHistory { backgroundThread, loopBuffer, loopBufferLock };
+    
+    ProgramBank programBank;
+    
+    // where the delay was reading from before a program switch, so the block
+    // after a switch can fade from the old taps to the new ones
+    struct Taps
+    {
+        int loopSpreadPosition { 0 };
+        int loopScanPosition { 0 };
+        int delayOutPosition { 0 };
+        float level { 0 };
+        float feedback { 0 };
+    };
+    Taps fadeFrom;
 };
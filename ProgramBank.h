@@ -0,0 +1,194 @@
+/*
+  ==============================================================================
+
+    ProgramBank.h
+    Created: 19 Oct 2026 4:48:30pm
+    Author:  Easton Elting
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+// What gets saved for a program, in the same units the processor keeps them
+// in except for the loop taps, which are stored in seconds so a program
+// survives a sample rate change.
+struct ProgramParameters
+{
+    juce::String name;
+    float level { 0 };
+    float feedback { 0 };
+    float delayRate { 1 };
+    float cutoff { 1 };
+    float loopSpreadSeconds { 0 };
+    float loopScanSeconds { 0 };
+};
+
+// A program with everything processBlock needs already worked out for the
+// current sample rate, so switching to it is just a copy.
+struct ProgramSnapshot
+{
+    float level { 0 };
+    float feedback { 0 };
+    float delayRate { 1 };
+    float samplesOfDelay { 0 };
+    float cutoff { 1 };
+    int loopSpread { 0 };
+    int loopScan { 0 };
+    float filterG { 0 };
+    float filterR2 { 0 };
+    float filterH { 0 };
+};
+
+class ProgramBank
+{
+public:
+    static constexpr int numPrograms { 8 };
+
+    // the delay rates setDelayRate can produce, 2^1/16 up to 2^MAX_DELAY_RATE/16
+    // beats, the longest delay delayBuffer is sized for
+    static constexpr float minDelayRate { 2.0f / 16 };
+    static constexpr float maxDelayRate { 128.0f / 16 };
+
+    ProgramBank()
+    {
+        for (int index = 0; index < numPrograms; ++index) {
+            programs[index].name = "Program " + juce::String(index + 1);
+        }
+    }
+
+    int getCurrentProgram() const { return currentProgram; }
+
+    const ProgramParameters& getProgram(int index) const { return programs[(size_t) index]; }
+
+    void setProgramName(int index, const juce::String& newName) { programs[(size_t) index].name = newName; }
+
+    // Message thread. The snapshot has to be derived from parameters by the caller.
+    void setProgram(int index, const ProgramParameters& parameters, const ProgramSnapshot& snapshot)
+    {
+        programs[(size_t) index] = parameters;
+        setSnapshot(index, snapshot);
+    }
+
+    void setSnapshot(int index, const ProgramSnapshot& snapshot)
+    {
+        const juce::SpinLock::ScopedLockType lock(snapshotLock);
+        snapshots[(size_t) index] = snapshot;
+    }
+
+    // Message thread. The audio thread picks the program up at its next block.
+    void select(int index)
+    {
+        currentProgram = index;
+        pendingProgram.store(index);
+    }
+
+    // Audio thread. If a snapshot is being rewritten right now the switch is
+    // put back and picked up on the next block instead.
+    bool takePendingSnapshot(ProgramSnapshot& snapshot)
+    {
+        auto index = pendingProgram.exchange(-1);
+        if (index < 0) {
+            return false;
+        }
+
+        const juce::SpinLock::ScopedTryLockType lock(snapshotLock);
+        if (! lock.isLocked()) {
+            auto expected = -1;
+            pendingProgram.compare_exchange_strong(expected, index);
+            return false;
+        }
+
+        snapshot = snapshots[(size_t) index];
+        return true;
+    }
+
+    // Layout: magic, version, current program, program count, then for each
+    // program its name followed by the six parameters as floats.
+    void writeTo(juce::MemoryBlock& destData) const
+    {
+        juce::MemoryOutputStream stream(destData, false);
+        stream.writeInt(magic);
+        stream.writeByte(version);
+        stream.writeByte((char) currentProgram);
+        stream.writeByte((char) numPrograms);
+
+        for (auto& program : programs) {
+            stream.writeString(program.name);
+            stream.writeFloat(program.level);
+            stream.writeFloat(program.feedback);
+            stream.writeFloat(program.delayRate);
+            stream.writeFloat(program.cutoff);
+            stream.writeFloat(program.loopSpreadSeconds);
+            stream.writeFloat(program.loopScanSeconds);
+        }
+    }
+
+    // Returns false and leaves the bank alone if the data isn't a bank this
+    // version can read. Host state can be corrupt, so anything that isn't a
+    // finite number is rejected and the rest is clamped to what the knobs allow.
+    bool readFrom(const void* data, int sizeInBytes)
+    {
+        juce::MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+        if (stream.readInt() != magic || stream.readByte() != version) {
+            return false;
+        }
+
+        auto current = (int) (juce::uint8) stream.readByte();
+        auto count = (int) (juce::uint8) stream.readByte();
+
+        std::array<ProgramParameters, numPrograms> loaded = programs;
+        for (int index = 0; index < count; ++index) {
+            ProgramParameters program;
+            program.name = stream.readString();
+
+            // a truncated chunk would read the missing floats as zeros
+            if (stream.getNumBytesRemaining() < 6 * (int) sizeof(float)) {
+                return false;
+            }
+            program.level = stream.readFloat();
+            program.feedback = stream.readFloat();
+            program.delayRate = stream.readFloat();
+            program.cutoff = stream.readFloat();
+            program.loopSpreadSeconds = stream.readFloat();
+            program.loopScanSeconds = stream.readFloat();
+
+            for (auto value : { program.level, program.feedback, program.delayRate, program.cutoff,
+                                program.loopSpreadSeconds, program.loopScanSeconds }) {
+                if (! std::isfinite(value)) {
+                    return false;
+                }
+            }
+            program.level = juce::jlimit(0.0f, 1.0f, program.level);
+            program.feedback = juce::jlimit(0.0f, 1.0f, program.feedback);
+            program.delayRate = juce::jlimit(minDelayRate, maxDelayRate, program.delayRate);
+            program.cutoff = juce::jlimit(1.0f, 20000.0f, program.cutoff);
+            program.loopSpreadSeconds = juce::jmax(0.0f, program.loopSpreadSeconds);
+            program.loopScanSeconds = juce::jmax(0.0f, program.loopScanSeconds);
+
+            if (index < numPrograms) {
+                loaded[(size_t) index] = program;
+            }
+        }
+
+        programs = loaded;
+        currentProgram = juce::jlimit(0, numPrograms - 1, current);
+        return true;
+    }
+
+private:
+    static constexpr int magic { 0x62504448 }; // "HDPb"
+    static constexpr char version { 1 };
+
+    std::array<ProgramParameters, numPrograms> programs;
+    int currentProgram { 0 };
+
+    std::array<ProgramSnapshot, numPrograms> snapshots;
+    std::atomic<int> pendingProgram { -1 };
+    juce::SpinLock snapshotLock;
+};